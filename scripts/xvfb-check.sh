@@ -0,0 +1,122 @@
+#!/bin/sh
+# Builds monsterbar and i3glow with and without PRESENT=1 and runs both under Xvfb.
+#
+# Each build must be free of compiler warnings. monsterbar is fed a burst of desktop updates faster
+# than the refresh rate; in the PRESENT=1 build, every frame the presenter defers must later be drawn.
+# Xvfb normally provides the Present extension, so that build exercises the pixmap path, and it fails
+# if Present turns out to be missing or no frame was deferred, rather than passing without having
+# tested anything. The immediate path is exercised by the build without PRESENT.
+#
+# i3glow needs a running i3, so it is only run if i3 and i3-msg are installed. The deferred/drawn
+# counts of every run are printed again at the end, in a form that can be pasted as-is.
+#
+# Needs Xvfb and the usual build dependencies (cairo, json-c, xcb-util, xcb-present, i3's ipc.h).
+#
+#   scripts/xvfb-check.sh [display]
+
+set -e
+
+cd "$(dirname "$0")/.."
+
+DISPLAY_NAME=${1:-:99}
+LOG_DIR=$(mktemp -d)
+SUMMARY=
+
+Xvfb "$DISPLAY_NAME" -screen 0 1280x800x24 >"$LOG_DIR/xvfb.log" 2>&1 &
+XVFB_PID=$!
+trap 'kill $XVFB_PID 2>/dev/null; [ -n "$I3_PID" ] && kill $I3_PID 2>/dev/null; true' EXIT
+sleep 1
+
+export DISPLAY="$DISPLAY_NAME"
+
+# Checks a bar's DEBUG log: every deferred frame must have been drawn, and the PRESENT=1 build must
+# actually have taken the Present path. monsterbar, fed faster than the refresh rate, must also have
+# deferred at least one frame.
+check_present_log() {
+	BAR=$1
+	LOG="$LOG_DIR/$BAR-$NAME.log"
+
+	DEFERRED=$(grep -c 'present: deferring frame' "$LOG" || true)
+	DRAWN=$(grep -c 'present: drawing deferred frame' "$LOG" || true)
+	echo "   deferred $DEFERRED times, drew $DRAWN deferred frames"
+	SUMMARY="$SUMMARY$BAR $NAME: deferred $DEFERRED, drawn $DRAWN
+"
+
+	if [ "$DEFERRED" != "$DRAWN" ]; then
+		echo "FAIL: $BAR $NAME left deferred frames undrawn"
+		exit 1
+	fi
+
+	if [ -n "$PRESENT" ]; then
+		if grep -q 'Present extension not available\|could not query Present version' "$LOG"; then
+			echo "FAIL: $BAR $NAME fell back to immediate presentation; this Xvfb lacks Present"
+			exit 1
+		fi
+
+		if [ "$BAR" = monsterbar ] && [ "$DEFERRED" = 0 ]; then
+			echo "FAIL: $BAR $NAME never deferred a frame, so the pacing was not exercised"
+			exit 1
+		fi
+	fi
+}
+
+desktop_updates() {
+	for i in $(seq 1 100); do
+		echo "0:1:0:$((i % 2)):0:web 1:2:0:$(((i + 1) % 2)):0:dev 2:0:0:0:$((i % 3 == 0))"
+		sleep 0.002
+	done
+	sleep 1
+}
+
+for PRESENT in "" 1; do
+	NAME=${PRESENT:+present}
+	NAME=${NAME:-immediate}
+
+	echo "== $NAME: build"
+	make -B DEBUG=1 PRESENT=$PRESENT >"$LOG_DIR/build-$NAME.log" 2>&1 || { cat "$LOG_DIR/build-$NAME.log"; exit 1; }
+	if grep -q 'warning:' "$LOG_DIR/build-$NAME.log"; then
+		cat "$LOG_DIR/build-$NAME.log"
+		echo "FAIL: $NAME build has warnings"
+		exit 1
+	fi
+
+	echo "== $NAME: monsterbar"
+	desktop_updates | build/monsterbar 2>"$LOG_DIR/monsterbar-$NAME.log" || { cat "$LOG_DIR/monsterbar-$NAME.log"; exit 1; }
+
+	check_present_log monsterbar
+
+	if command -v i3 >/dev/null && command -v i3-msg >/dev/null; then
+		echo "== $NAME: i3glow"
+		echo '# no bar, no keybindings' >"$LOG_DIR/i3.config"
+		i3 -c "$LOG_DIR/i3.config" >"$LOG_DIR/i3.log" 2>&1 &
+		I3_PID=$!
+		sleep 1
+
+		build/i3glow 2>"$LOG_DIR/i3glow-$NAME.log" &
+		I3GLOW_PID=$!
+		sleep 1
+
+		for ws in 2 "3:web" 1 "3:web" 2; do i3-msg -q "workspace $ws"; done
+		i3-msg -q 'rename workspace 2 to "2:dev"'
+		sleep 1
+
+		if ! kill $I3GLOW_PID 2>/dev/null; then
+			cat "$LOG_DIR/i3glow-$NAME.log"
+			echo "FAIL: $NAME i3glow exited early"
+			exit 1
+		fi
+		echo "   still running after workspace switches"
+
+		check_present_log i3glow
+
+		kill $I3_PID
+		wait $I3_PID 2>/dev/null || true
+		I3_PID=
+	else
+		echo "== $NAME: i3glow skipped, i3 is not installed"
+	fi
+done
+
+echo "logs in $LOG_DIR"
+echo
+printf '%s' "$SUMMARY"
@@ -11,6 +11,7 @@
 #include <sys/select.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <time.h>
 #include <unistd.h>
 #include <xcb/xcb.h>
 #include <xcb/xcb_event.h>
@@ -24,6 +25,11 @@
 #define I3G_INDICATORWIDTH 20
 #define I3G_INDICATORSPACE 12
 #define I3G_WS_SHOW_OFFSET 1
+#define I3G_LABELSIZE 7
+#define I3G_PIPSIZE 2
+#define I3G_PIPSPACE 2
+#define I3G_MAXPIPS 5
+#define I3G_MAXWINDOWS 512
 
 struct {
 	struct {
@@ -31,21 +37,53 @@ struct {
 		int mode;
 		bool active;
 		bool urgent;
+		int n_windows;
+		char *label;
 	} desktops[64];
 
+	// Workspace num of every container holding a window, kept up to date from window events so
+	// that a GET_TREE is only needed to resync.
+	struct {
+		int64_t id;
+		int num;
+	} windows[I3G_MAXWINDOWS];
+	int n_windows;
+
+	// Set when an event leaves the workspaces or the window map stale; they are refetched once the
+	// pending events have been handled, so a burst of events costs a single request.
+	bool workspaces_dirty;
+	bool workspaces_pending;
+	bool tree_dirty;
+	bool tree_pending;
+
+#ifdef DEBUG
+	struct {
+		uint32_t last_tree_bytes;
+		double last_tree_us;
+		int n_resyncs;
+		double resyncs_us;
+		bool in_resync;
+		int n_events;
+		double events_us;
+	} bench;
+#endif
+
 	xcb_connection_t *c;
 	xcb_screen_t *screen;
 	xcb_visualtype_t *argb_visual;
 
 	xcb_window_t window;
-	cairo_surface_t *surface;
+	XPresenter present;
 
 	int i3_fd;
 } i3g;
 
 void i3g_draw() {
+	cairo_surface_t *surface = x_present_begin(&i3g.present);
+	if (!surface) return;
+
 	int width = i3g.screen->width_in_pixels;
-	cairo_t *cr = cairo_create(i3g.surface);
+	cairo_t *cr = cairo_create(surface);
 
 	cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
 	cairo_paint(cr);
@@ -80,12 +118,25 @@ void i3g_draw() {
 		}
 
 		cairo_new_path(cr);
+
+		if (i3g.desktops[i].seen) {
+			cairo_set_source_rgba(cr, .3, .3, .3, .8);
+
+			for (int pip = 0; pip < i3g.desktops[i].n_windows && pip < I3G_MAXPIPS; pip++) {
+				cairo_rectangle(cr, I3G_INDICATORSPACE + (I3G_INDICATORWIDTH + I3G_INDICATORSPACE) * (i - I3G_WS_SHOW_OFFSET) + (I3G_PIPSIZE + I3G_PIPSPACE) * pip, I3G_BARHEIGHT, I3G_PIPSIZE, I3G_PIPSIZE);
+			}
+			cairo_fill(cr);
+		}
+
+		if (i3g.desktops[i].seen && i3g.desktops[i].label) {
+			cairo_set_source_rgba(cr, 0, 0, 0, .8);
+			c_show_label(cr, i3g.desktops[i].label, I3G_LABELSIZE, I3G_INDICATORSPACE + (I3G_INDICATORWIDTH + I3G_INDICATORSPACE) * (i - I3G_WS_SHOW_OFFSET), 0, I3G_INDICATORWIDTH, I3G_BARHEIGHT);
+		}
 	}
 
 	cairo_destroy(cr);
 
-	cairo_surface_flush(i3g.surface);
-	xcb_flush(i3g.c);
+	x_present_end(&i3g.present);
 }
 
 void i3g_handle_event(xcb_generic_event_t *event) {
@@ -96,6 +147,9 @@ void i3g_handle_event(xcb_generic_event_t *event) {
 		case XCB_VISIBILITY_NOTIFY:
 			x_raise_window(i3g.c, i3g.window);
 			break;
+		case XCB_GE_GENERIC:
+			if (x_present_handle_event(&i3g.present, event)) i3g_draw();
+			break;
 		default:
 			FG_DEBUG("unhandled event %s", xcb_event_get_label(event->response_type));
 			break;
@@ -112,21 +166,284 @@ void i3g_i3_send(uint32_t type, const char *payload) {
 	write(i3g.i3_fd, payload, header.size);
 }
 
-void i3g_i3_init_workspaces(json_object *payload) {
+// Workspaces named "N" get no label, and "N:foo" is labelled "foo".
+static char* _i3g_workspace_label(int num, const char *name) {
+	if (!name) return NULL;
+
+	char prefix[16];
+	int prefix_len = snprintf(prefix, sizeof(prefix), "%d", num);
+
+	if (strncmp(name, prefix, prefix_len) == 0) {
+		if (name[prefix_len] == '\0') return NULL;
+		if (name[prefix_len] == ':' && name[prefix_len + 1] != '\0') return strdup(name + prefix_len + 1);
+	}
+
+	return strdup(name);
+}
+
+// Returns whether any workspace's indicator changed.
+bool i3g_i3_init_workspaces(json_object *payload) {
 	json_object *workspace;
+	typeof(i3g.desktops) old;
 
-	for (int num = 0; num < 64; num++) i3g.desktops[num].seen = false;
+	memcpy(old, i3g.desktops, sizeof(old));
+	i3g.workspaces_dirty = false;
+	i3g.workspaces_pending = false;
+
+	for (int num = 0; num < 64; num++) {
+		i3g.desktops[num].seen = false;
+		i3g.desktops[num].active = false;
+		i3g.desktops[num].urgent = false;
+		i3g.desktops[num].label = NULL;
+	}
 
 	for (int i = 0; (workspace = json_object_array_get_idx(payload, i)); i++) {
 		int num = json_object_get_int(json_object_object_get(workspace, "num"));
 
+		// Workspaces without a number (num == -1) have no indicator slot.
+		if (num < 0 || num >= 64) continue;
+
 		i3g.desktops[num].seen = true;
+		i3g.desktops[num].label = _i3g_workspace_label(num, json_object_get_string(json_object_object_get(workspace, "name")));
 		i3g.desktops[num].active = json_object_get_boolean(json_object_object_get(workspace, "focused"));
 		i3g.desktops[num].urgent = json_object_get_boolean(json_object_object_get(workspace, "urgent"));
 	}
+
+	bool changed = false;
+	for (int num = 0; num < 64; num++) {
+		const char *old_label = old[num].label;
+		const char *label = i3g.desktops[num].label;
+
+		if (old[num].seen != i3g.desktops[num].seen
+				|| old[num].active != i3g.desktops[num].active
+				|| old[num].urgent != i3g.desktops[num].urgent
+				|| (!old_label != !label)
+				|| (old_label && strcmp(old_label, label) != 0)) {
+			changed = true;
+		}
+
+		free(old[num].label);
+	}
+
+	return changed;
+}
+
+bool i3g_i3_recv();
+
+static int _i3g_window_find(int64_t id) {
+	for (int i = 0; i < i3g.n_windows; i++) {
+		if (i3g.windows[i].id == id) return i;
+	}
+
+	return -1;
+}
+
+// Records that container `id` now lives on workspace `num`, adjusting window counts. Returns
+// whether any count changed.
+bool i3g_window_set(int64_t id, int num) {
+	if (num < 0 || num >= 64) return false;
+
+	int i = _i3g_window_find(id);
+	if (i == -1) {
+		if (i3g.n_windows == I3G_MAXWINDOWS) {
+			FG_DEBUG("more than %d windows, not counting 0x%llx", I3G_MAXWINDOWS, (long long) id);
+			return false;
+		}
+
+		i = i3g.n_windows++;
+		i3g.windows[i].id = id;
+	} else if (i3g.windows[i].num == num) {
+		return false;
+	} else {
+		i3g.desktops[i3g.windows[i].num].n_windows--;
+	}
+
+	i3g.windows[i].num = num;
+	i3g.desktops[num].n_windows++;
+
+	return true;
 }
 
-void i3g_i3_recv() {
+bool i3g_window_remove(int64_t id) {
+	int i = _i3g_window_find(id);
+	if (i == -1) return false;
+
+	i3g.desktops[i3g.windows[i].num].n_windows--;
+	i3g.windows[i] = i3g.windows[--i3g.n_windows];
+
+	return true;
+}
+
+static void _i3g_i3_walk_tree(json_object *node, int num) {
+	const char *type = json_object_get_string(json_object_object_get(node, "type"));
+	if (type && strcmp(type, "workspace") == 0) num = json_object_get_int(json_object_object_get(node, "num"));
+
+	// "window" is null for containers that do not hold a window.
+	if (json_object_object_get(node, "window")) i3g_window_set(json_object_get_int64(json_object_object_get(node, "id")), num);
+
+	json_object *child;
+	json_object *nodes = json_object_object_get(node, "nodes");
+	for (int i = 0; (child = json_object_array_get_idx(nodes, i)); i++) _i3g_i3_walk_tree(child, num);
+
+	json_object *floating_nodes = json_object_object_get(node, "floating_nodes");
+	for (int i = 0; (child = json_object_array_get_idx(floating_nodes, i)); i++) _i3g_i3_walk_tree(child, num);
+}
+
+bool i3g_i3_init_tree(json_object *payload) {
+	int old_counts[64];
+
+	for (int num = 0; num < 64; num++) {
+		old_counts[num] = i3g.desktops[num].n_windows;
+		i3g.desktops[num].n_windows = 0;
+	}
+	i3g.n_windows = 0;
+	i3g.tree_dirty = false;
+	i3g.tree_pending = false;
+
+	_i3g_i3_walk_tree(payload, -1);
+
+	for (int num = 0; num < 64; num++) {
+		if (i3g.desktops[num].n_windows != old_counts[num]) return true;
+	}
+
+	return false;
+}
+
+#ifdef DEBUG
+static double _i3g_elapsed_us(struct timespec *start) {
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return (end.tv_sec - start->tv_sec) * 1e6 + (end.tv_nsec - start->tv_nsec) / 1e3;
+}
+
+// Compares the incremental window tracking, including the resyncs it needs, against the naive
+// approach of a full GET_TREE round trip for every window event.
+static void _i3g_bench_window_event(double elapsed_us) {
+	// Events handled while waiting for a GET_TREE reply are part of neither side of the comparison.
+	if (i3g.bench.in_resync) return;
+
+	i3g.bench.n_events++;
+	i3g.bench.events_us += elapsed_us;
+
+	if (i3g.bench.n_events % 100 == 0) {
+		FG_DEBUG("%d window events: %.1fus handling them plus %.1fus in %d GET_TREE resyncs; a GET_TREE round trip per event would have taken ~%.1fus",
+			i3g.bench.n_events,
+			i3g.bench.events_us,
+			i3g.bench.resyncs_us,
+			i3g.bench.n_resyncs,
+			i3g.bench.n_events * i3g.bench.last_tree_us
+		);
+	}
+}
+#endif
+
+// Fetches the whole tree, handling any events that arrive before the reply.
+bool i3g_i3_resync_tree() {
+	bool changed = false;
+
+#ifdef DEBUG
+	struct timespec start;
+	double other_us = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	i3g.bench.in_resync = true;
+#endif
+
+	i3g_i3_send(I3_IPC_MESSAGE_TYPE_GET_TREE, "");
+	i3g.tree_pending = true;
+	while (i3g.tree_pending) {
+#ifdef DEBUG
+		struct timespec recv_start;
+		clock_gettime(CLOCK_MONOTONIC, &recv_start);
+#endif
+
+		changed |= i3g_i3_recv();
+
+#ifdef DEBUG
+		// Messages handled ahead of the reply are not part of the round trip.
+		if (i3g.tree_pending) other_us += _i3g_elapsed_us(&recv_start);
+#endif
+	}
+
+#ifdef DEBUG
+	// Covers i3 serialising the tree and the transfer as well as parsing and walking it.
+	i3g.bench.in_resync = false;
+	i3g.bench.last_tree_us = _i3g_elapsed_us(&start) - other_us;
+	i3g.bench.n_resyncs++;
+	i3g.bench.resyncs_us += i3g.bench.last_tree_us;
+	FG_DEBUG("GET_TREE round trip: %u bytes in %.1fus", i3g.bench.last_tree_bytes, i3g.bench.last_tree_us);
+#endif
+
+	return changed;
+}
+
+static bool _i3g_i3_readable() {
+	fd_set rfds;
+	struct timeval timeout = { 0, 0 };
+
+	FD_ZERO(&rfds);
+	FD_SET(i3g.i3_fd, &rfds);
+
+	return select(i3g.i3_fd + 1, &rfds, NULL, NULL, &timeout) > 0;
+}
+
+// i3 writes "change" first in window events, so those that cannot affect window counts (focus,
+// title, mark, urgent, ...) can be dropped without parsing the container they carry.
+static bool _i3g_window_event_ignored(const char *payload) {
+	static const char prefix[] = "{\"change\":\"";
+	static const char *handled[] = { "new\"", "close\"", "move\"" };
+
+	if (strncmp(payload, prefix, sizeof(prefix) - 1) != 0) return false;
+	payload += sizeof(prefix) - 1;
+
+	for (int i = 0; i < sizeof(handled) / sizeof(*handled); i++) {
+		if (strncmp(payload, handled[i], strlen(handled[i])) == 0) return false;
+	}
+
+	return true;
+}
+
+bool i3g_i3_handle_window_event(json_object *payload) {
+	const char *change = json_object_get_string(json_object_object_get(payload, "change"));
+	int64_t id = json_object_get_int64(json_object_object_get(json_object_object_get(payload, "container"), "id"));
+
+	if (!change) return false;
+
+	if (strcmp(change, "close") == 0) {
+		return i3g_window_remove(id);
+	} else if (strcmp(change, "new") == 0 || strcmp(change, "move") == 0) {
+		// Neither event says which workspace the container is on (new windows are not always placed
+		// on the focused one, e.g. with assign rules), so the tree has to be refetched.
+		i3g.tree_dirty = true;
+	}
+
+	return false;
+}
+
+bool i3g_i3_handle_workspace_event(json_object *payload) {
+	const char *change = json_object_get_string(json_object_object_get(payload, "change"));
+
+	// Renumbering a workspace invalidates the num of every container on it.
+	if (change && (strcmp(change, "rename") == 0 || strcmp(change, "reload") == 0)) i3g.tree_dirty = true;
+
+	i3g.workspaces_dirty = true;
+	return false;
+}
+
+// Fetches the workspaces, handling any events that arrive before the reply.
+bool i3g_i3_refresh_workspaces() {
+	bool changed = false;
+
+	i3g_i3_send(I3_IPC_MESSAGE_TYPE_GET_WORKSPACES, "");
+	i3g.workspaces_pending = true;
+	while (i3g.workspaces_pending) changed |= i3g_i3_recv();
+
+	return changed;
+}
+
+// Reads and handles one message from i3, returning whether anything shown on the bar changed.
+bool i3g_i3_recv() {
 	struct i3_ipc_header header;
 	ssize_t header_read = read(i3g.i3_fd, &header, sizeof(header));
 	if (header_read < 0) {
@@ -152,19 +469,39 @@ void i3g_i3_recv() {
 		bytes_read += chunk_read;
 	}
 
+#ifdef DEBUG
+	// The event has to be read under either approach, so only handling it is timed.
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+#endif
+
+	if (header.type == I3_IPC_EVENT_WINDOW && _i3g_window_event_ignored(payload)) {
+		free(payload);
+#ifdef DEBUG
+		_i3g_bench_window_event(_i3g_elapsed_us(&start));
+#endif
+		return false;
+	}
+
 	json_object *payload_obj = json_tokener_parse(payload);
+	bool changed = false;
 
 	if (header.type & I3_IPC_EVENT_MASK) {
 		switch (header.type) {
 			case I3_IPC_EVENT_WORKSPACE:
-				i3g_i3_send(I3_IPC_MESSAGE_TYPE_GET_WORKSPACES, "");
-				i3g_i3_recv();
+				changed = i3g_i3_handle_workspace_event(payload_obj);
+				break;
+			case I3_IPC_EVENT_WINDOW:
+				changed = i3g_i3_handle_window_event(payload_obj);
 				break;
 		}
 	} else {
 		switch (header.type) {
 			case I3_IPC_REPLY_TYPE_WORKSPACES:
-				i3g_i3_init_workspaces(payload_obj);
+				changed = i3g_i3_init_workspaces(payload_obj);
+				break;
+			case I3_IPC_REPLY_TYPE_TREE:
+				changed = i3g_i3_init_tree(payload_obj);
 				break;
 			case I3_IPC_REPLY_TYPE_SUBSCRIBE:
 				if (!json_object_get_boolean(json_object_object_get(payload_obj, "success"))) FG_FAIL("subscribe failed");
@@ -173,6 +510,14 @@ void i3g_i3_recv() {
 	}
 
 	json_object_put(payload_obj);
+	free(payload);
+
+#ifdef DEBUG
+	if (header.type == I3_IPC_REPLY_TYPE_TREE) i3g.bench.last_tree_bytes = header.size;
+	if (header.type == I3_IPC_EVENT_WINDOW) _i3g_bench_window_event(_i3g_elapsed_us(&start));
+#endif
+
+	return changed;
 }
 
 void i3g_i3_connect() {
@@ -187,11 +532,11 @@ void i3g_i3_connect() {
 
 	if (connect(i3g.i3_fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) FG_FAIL_ERRNO("i3 connect failed: %s");
 
-	i3g_i3_send(I3_IPC_MESSAGE_TYPE_SUBSCRIBE, "[\"workspace\"]");
+	i3g_i3_send(I3_IPC_MESSAGE_TYPE_SUBSCRIBE, "[\"workspace\",\"window\"]");
 	i3g_i3_recv();
 
-	i3g_i3_send(I3_IPC_MESSAGE_TYPE_GET_WORKSPACES, "");
-	i3g_i3_recv();
+	i3g_i3_refresh_workspaces();
+	i3g_i3_resync_tree();
 }
 
 int main() {
@@ -221,7 +566,7 @@ int main() {
 	x_set_net_wm_window_type(i3g.c, i3g.window, _NET_WM_WINDOW_TYPE_DOCK);
 	X_CHECKED(xcb_map_window_checked(i3g.c, i3g.window));
 
-	i3g.surface = cairo_xcb_surface_create(i3g.c, i3g.window, i3g.argb_visual, i3g.screen->width_in_pixels, I3G_WINDOWHEIGHT);
+	x_present_init(&i3g.present, i3g.c, i3g.window, i3g.argb_visual, 32, i3g.screen->width_in_pixels, I3G_WINDOWHEIGHT);
 
 	int xcb_fd = xcb_get_file_descriptor(i3g.c);
 	i3g_i3_connect();
@@ -240,9 +585,18 @@ int main() {
 		if (select(MAX(xcb_fd, i3g.i3_fd) + 1, &rfds, NULL, NULL, NULL) == -1) FG_FAIL("select failed: %s", strerror(errno));
 
 		if (FD_ISSET(i3g.i3_fd, &rfds)) {
-			i3g_i3_recv();
+			bool changed = false;
 
-			i3g_draw();
+			do {
+				changed |= i3g_i3_recv();
+			} while (_i3g_i3_readable());
+
+			// Events handled while waiting for one reply may make the other stale again.
+			while (i3g.workspaces_dirty || i3g.tree_dirty) {
+				if (i3g.workspaces_dirty) changed |= i3g_i3_refresh_workspaces();
+				if (i3g.tree_dirty) changed |= i3g_i3_resync_tree();
+			}
+			if (changed) i3g_draw();
 		} else {
 			while ((event = xcb_poll_for_event(i3g.c))) {
 				i3g_handle_event(event);
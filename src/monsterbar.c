@@ -13,10 +13,17 @@
 
 #include "util.h"
 
+#define X_CHECKED(code) { xcb_generic_error_t *error; xcb_void_cookie_t cookie = code; if ((error = xcb_request_check(mb.c, cookie))) FG_FAIL("X11 request at %s:%d failed with %s", __FILE__, __LINE__, xcb_event_get_error_label(error->error_code)); }
+
 #define MB_BARHEIGHT 3
 #define MB_WINDOWHEIGHT 6
 #define MB_INDICATORWIDTH 20
 #define MB_INDICATORSPACE 12
+#define MB_LABELSIZE 6
+#define MB_LABELMAX 63
+
+#define MB_STR(x) #x
+#define MB_XSTR(x) MB_STR(x)
 
 struct {
 	struct {
@@ -25,6 +32,7 @@ struct {
 		int mode;
 		bool active;
 		bool urgent;
+		char label[MB_LABELMAX + 1];
 	} desktops[64];
 
 	xcb_connection_t *c;
@@ -32,12 +40,15 @@ struct {
 	xcb_visualtype_t *argb_visual;
 
 	xcb_window_t window;
-	cairo_surface_t *surface;
+	XPresenter present;
 } mb;
 
 void mb_draw() {
+	cairo_surface_t *surface = x_present_begin(&mb.present);
+	if (!surface) return;
+
 	int width = mb.screen->width_in_pixels;
-	cairo_t *cr = cairo_create(mb.surface);
+	cairo_t *cr = cairo_create(surface);
 
 	cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
 	cairo_paint(cr);
@@ -59,12 +70,31 @@ void mb_draw() {
 			cairo_set_source_rgba(cr, 0, 0, 0, 0);
 		}
 		cairo_fill(cr);
+
+		if (mb.desktops[i].label[0]) {
+			int x = MB_INDICATORSPACE + (MB_INDICATORWIDTH + MB_INDICATORSPACE) * i;
+
+			// An empty desktop shows the bar only down to MB_BARHEIGHT, so continue it under the
+			// label. Only the dark grey of an occupied desktop then needs light text.
+			if (!mb.desktops[i].active && !mb.desktops[i].urgent && !mb.desktops[i].n_windows) {
+				cairo_rectangle(cr, x, MB_BARHEIGHT, MB_INDICATORWIDTH, MB_WINDOWHEIGHT - MB_BARHEIGHT);
+				cairo_set_source_rgba(cr, 1, 1, 1, .8);
+				cairo_fill(cr);
+			}
+
+			if (!mb.desktops[i].active && !mb.desktops[i].urgent && mb.desktops[i].n_windows) {
+				cairo_set_source_rgba(cr, 1, 1, 1, .9);
+			} else {
+				cairo_set_source_rgba(cr, 0, 0, 0, .8);
+			}
+
+			c_show_label(cr, mb.desktops[i].label, MB_LABELSIZE, x, 0, MB_INDICATORWIDTH, MB_WINDOWHEIGHT);
+		}
 	}
 
 	cairo_destroy(cr);
 
-	cairo_surface_flush(mb.surface);
-	xcb_flush(mb.c);
+	x_present_end(&mb.present);
 }
 
 void mb_handle_event(xcb_generic_event_t *event) {
@@ -75,6 +105,9 @@ void mb_handle_event(xcb_generic_event_t *event) {
 		case XCB_VISIBILITY_NOTIFY:
 			x_raise_window(mb.c, mb.window);
 			break;
+		case XCB_GE_GENERIC:
+			if (x_present_handle_event(&mb.present, event)) mb_draw();
+			break;
 		default:
 			FG_DEBUG("unhandled event %s", xcb_event_get_label(event->response_type));
 			break;
@@ -107,7 +140,7 @@ int main() {
 	x_set_net_wm_window_type(mb.c, mb.window, _NET_WM_WINDOW_TYPE_DOCK);
 	X_CHECKED(xcb_map_window_checked(mb.c, mb.window));
 
-	mb.surface = cairo_xcb_surface_create(mb.c, mb.window, mb.argb_visual, mb.screen->width_in_pixels, 6);
+	x_present_init(&mb.present, mb.c, mb.window, mb.argb_visual, 32, mb.screen->width_in_pixels, 6);
 
 	int xcb_fd = xcb_get_file_descriptor(mb.c);
 	fd_set rfds;
@@ -126,6 +159,7 @@ int main() {
 
 		if (FD_ISSET(0, &rfds)) {
 			int i, n_windows, mode, urgent, active;
+			char label[MB_LABELMAX + 1];
 
 			char *line = NULL;
 			size_t len;
@@ -142,6 +176,20 @@ int main() {
 				mb.desktops[i].active = active;
 
 				line += num_read;
+
+				// An optional ":label" may follow each desktop's fields. Labels longer than
+				// MB_LABELMAX are truncated, and the rest of the token skipped.
+				label[0] = '\0';
+				num_read = 0;
+				sscanf(line, ":%" MB_XSTR(MB_LABELMAX) "[^ \t\n]%n", label, &num_read);
+				strcpy(mb.desktops[i].label, label);
+
+				if (num_read) {
+					line += num_read + strcspn(line + num_read, " \t\n");
+				} else if (*line == ':') {
+					// An empty label.
+					line++;
+				}
 			}
 
 			mb_draw();
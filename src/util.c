@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <cairo.h>
+#include <cairo-xcb.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdbool.h>
@@ -8,6 +9,9 @@
 #include <limits.h>
 #include <xcb/xcb.h>
 #include <xcb/xcb_event.h>
+#ifdef FG_PRESENT
+#include <xcb/present.h>
+#endif
 
 #include "util.h"
 
@@ -257,3 +261,236 @@ char* x_get_string_property(xcb_connection_t *c, xcb_window_t win, XAtom propert
 	free(reply);
 	return result;
 }
+
+void x_present_init(XPresenter *p, xcb_connection_t *c, xcb_window_t window, xcb_visualtype_t *visual, int depth, int width, int height) {
+	p->c = c;
+	p->window = window;
+	p->window_surface = cairo_xcb_surface_create(c, window, visual, width, height);
+	p->enabled = false;
+
+#ifdef FG_PRESENT
+	const xcb_query_extension_reply_t *extension = xcb_get_extension_data(c, &xcb_present_id);
+	if (!extension || !extension->present) {
+		FG_DEBUG("Present extension not available, presenting immediately");
+		return;
+	}
+
+	xcb_present_query_version_reply_t *version = xcb_present_query_version_reply(c, xcb_present_query_version(c, XCB_PRESENT_MAJOR_VERSION, XCB_PRESENT_MINOR_VERSION), NULL);
+	if (!version) {
+		FG_DEBUG("could not query Present version, presenting immediately");
+		return;
+	}
+	free(version);
+
+	p->opcode = extension->major_opcode;
+	p->eid = xcb_generate_id(c);
+	X_CHECKED_API(xcb_present_select_input_checked(c, p->eid, window, XCB_PRESENT_EVENT_MASK_COMPLETE_NOTIFY | XCB_PRESENT_EVENT_MASK_IDLE_NOTIFY));
+
+	for (int i = 0; i < 2; i++) {
+		p->buffers[i].pixmap = xcb_generate_id(c);
+		X_CHECKED_API(xcb_create_pixmap_checked(c, depth, p->buffers[i].pixmap, window, width, height));
+		p->buffers[i].surface = cairo_xcb_surface_create(c, p->buffers[i].pixmap, visual, width, height);
+		p->buffers[i].busy = false;
+	}
+
+	p->back = 0;
+	p->serial = 0;
+	p->pending = false;
+	p->dirty = false;
+	p->msc = 0;
+	p->enabled = true;
+#endif
+}
+
+// Returns the surface to draw the next frame on, or NULL if a frame is still in flight. In that
+// case the frame is deferred, and x_present_handle_event() asks for a redraw once it can be shown;
+// any other frames requested in the meantime are dropped.
+cairo_surface_t* x_present_begin(XPresenter *p) {
+#ifdef FG_PRESENT
+	if (p->enabled) {
+		if (p->pending || p->buffers[p->back].busy) {
+#ifdef DEBUG
+			if (!p->dirty) FG_DEBUG("present: deferring frame until serial %u completes", p->serial);
+#endif
+			p->dirty = true;
+			return NULL;
+		}
+
+		return p->buffers[p->back].surface;
+	}
+#endif
+
+	return p->window_surface;
+}
+
+void x_present_end(XPresenter *p) {
+#ifdef FG_PRESENT
+	if (p->enabled) {
+		cairo_surface_flush(p->buffers[p->back].surface);
+
+		// Target the vblank after the last one we saw complete; if that has already passed, the
+		// server shows the frame at the next one.
+		xcb_present_pixmap(p->c, p->window, p->buffers[p->back].pixmap, ++p->serial,
+			XCB_NONE, XCB_NONE,
+			0, 0,
+			XCB_NONE, XCB_NONE, XCB_NONE,
+			XCB_PRESENT_OPTION_NONE,
+			p->msc + 1, 0, 0,
+			0, NULL
+		);
+
+		p->buffers[p->back].busy = true;
+		p->back ^= 1;
+		p->pending = true;
+		p->dirty = false;
+
+		xcb_flush(p->c);
+		return;
+	}
+#endif
+
+	cairo_surface_flush(p->window_surface);
+	xcb_flush(p->c);
+}
+
+// Handles Present events, returning true if a deferred frame should now be drawn.
+bool x_present_handle_event(XPresenter *p, xcb_generic_event_t *event) {
+#ifdef FG_PRESENT
+	if (!p->enabled || (event->response_type & XCB_EVENT_RESPONSE_TYPE_MASK) != XCB_GE_GENERIC) return false;
+
+	xcb_ge_generic_event_t *generic = (xcb_ge_generic_event_t *) event;
+	if (generic->extension != p->opcode) return false;
+
+	switch (generic->event_type) {
+		case XCB_PRESENT_COMPLETE_NOTIFY: {
+			xcb_present_complete_notify_event_t *complete = (xcb_present_complete_notify_event_t *) event;
+
+			if (complete->kind == XCB_PRESENT_COMPLETE_KIND_PIXMAP && complete->serial == p->serial) p->pending = false;
+			p->msc = complete->msc;
+			break;
+		}
+		case XCB_PRESENT_IDLE_NOTIFY: {
+			xcb_present_idle_notify_event_t *idle = (xcb_present_idle_notify_event_t *) event;
+
+			for (int i = 0; i < 2; i++) {
+				if (p->buffers[i].pixmap == idle->pixmap) p->buffers[i].busy = false;
+			}
+			break;
+		}
+	}
+
+	if (p->dirty && !p->pending && !p->buffers[p->back].busy) {
+#ifdef DEBUG
+		FG_DEBUG("present: drawing deferred frame after msc %llu", (unsigned long long) p->msc);
+#endif
+		return true;
+	}
+
+	return false;
+#else
+	return false;
+#endif
+}
+
+// Rasterised workspace labels, keyed by text, font size and box size. Each label is shaped, fitted
+// to its box and drawn into an A8 mask exactly once; redraws only blit the mask through the current
+// source, so the same entry serves every indicator colour. The cache is a fixed-size LRU, so churn
+// in workspace names cannot grow it without bound.
+static struct {
+	char *text;
+	double size;
+	int box_width;
+	int box_height;
+	cairo_surface_t *mask;
+	int width;
+	int height;
+	unsigned long last_used;
+} c_labels[C_LABEL_CACHE_SIZE];
+static unsigned long c_labels_clock;
+
+static cairo_surface_t* _c_render_label(const char *text, double size, int box_width, int box_height, int *width, int *height) {
+	cairo_surface_t *scratch = cairo_image_surface_create(CAIRO_FORMAT_A8, 1, 1);
+	cairo_t *cr = cairo_create(scratch);
+	cairo_text_extents_t extents;
+	cairo_font_extents_t font_extents;
+
+	cairo_select_font_face(cr, C_LABEL_FONT, CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+	cairo_set_font_size(cr, size);
+	cairo_font_extents(cr, &font_extents);
+
+	// Shrink the font if a line of it would not fit in the box.
+	if (font_extents.ascent + font_extents.descent > box_height) {
+		size *= box_height / (font_extents.ascent + font_extents.descent);
+		cairo_set_font_size(cr, size);
+		cairo_font_extents(cr, &font_extents);
+	}
+
+	// Drop trailing characters (whole UTF-8 sequences) until the ink fits, so the start of the
+	// name is always shown.
+	char *shown = strdup(text);
+	size_t len = strlen(shown);
+	cairo_text_extents(cr, shown, &extents);
+	while (len > 0 && ceil(extents.x_bearing + extents.width) - floor(extents.x_bearing) > box_width) {
+		do len--; while (len > 0 && (shown[len] & 0xc0) == 0x80);
+		shown[len] = '\0';
+		cairo_text_extents(cr, shown, &extents);
+	}
+
+	cairo_destroy(cr);
+	cairo_surface_destroy(scratch);
+
+	// Horizontally the mask covers the ink, rounded out to whole pixels; vertically it spans the
+	// font's ascent and descent, so that every label of a given size shares a baseline.
+	double left = floor(extents.x_bearing);
+	*width = MAX(1, (int) (ceil(extents.x_bearing + extents.width) - left));
+	*height = MAX(1, MIN(box_height, (int) ceil(font_extents.ascent + font_extents.descent)));
+
+	cairo_surface_t *mask = cairo_image_surface_create(CAIRO_FORMAT_A8, *width, *height);
+	cr = cairo_create(mask);
+	cairo_select_font_face(cr, C_LABEL_FONT, CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+	cairo_set_font_size(cr, size);
+	cairo_move_to(cr, -left, round(font_extents.ascent));
+	cairo_show_text(cr, shown);
+	cairo_destroy(cr);
+	cairo_surface_flush(mask);
+
+	free(shown);
+	return mask;
+}
+
+// Draws `text` left-aligned and vertically centered in the given box with the current source. Text
+// too wide for the box is truncated, and the font shrunk if it is too tall.
+void c_show_label(cairo_t *cr, const char *text, double size, int x, int y, int width, int height) {
+	int victim = 0;
+	int found = -1;
+
+	for (int i = 0; i < C_LABEL_CACHE_SIZE; i++) {
+		if (c_labels[i].text
+				&& c_labels[i].size == size
+				&& c_labels[i].box_width == width
+				&& c_labels[i].box_height == height
+				&& strcmp(c_labels[i].text, text) == 0) {
+			found = i;
+			break;
+		}
+
+		if (c_labels[i].last_used < c_labels[victim].last_used) victim = i;
+	}
+
+	if (found == -1) {
+		found = victim;
+
+		free(c_labels[found].text);
+		if (c_labels[found].mask) cairo_surface_destroy(c_labels[found].mask);
+
+		c_labels[found].text = strdup(text);
+		c_labels[found].size = size;
+		c_labels[found].box_width = width;
+		c_labels[found].box_height = height;
+		c_labels[found].mask = _c_render_label(text, size, width, height, &c_labels[found].width, &c_labels[found].height);
+	}
+
+	c_labels[found].last_used = ++c_labels_clock;
+
+	cairo_mask_surface(cr, c_labels[found].mask, x, y + (height - c_labels[found].height) / 2);
+}
@@ -2,12 +2,19 @@
 #define __UTIL_H__
 
 #include <errno.h>
+#include <stdbool.h>
 #include <string.h>
 
 #define FG_DEBUG(format, ...) fprintf(stderr, "monsterbar(%s:%d): " format "\n", __FILE__, __LINE__, ##__VA_ARGS__)
 #define FG_FAIL(format, ...) { fprintf(stderr, "monsterbar: " format "\n", ##__VA_ARGS__); abort(); }
 #define FG_FAIL_ERRNO(format, ...) FG_FAIL(format, strerror(errno), ##__VA_ARGS__)
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
+
+// Both bars have 64 indicator slots and redraw them in order, so an LRU holding fewer labels than
+// that would evict each label just before it is next drawn once more than that many are shown.
+#define C_LABEL_CACHE_SIZE 64
+#define C_LABEL_FONT "sans-serif"
 
 typedef enum {
 	_NET_WM_STATE,
@@ -21,7 +28,32 @@ typedef enum {
 	X_ATOM_COUNT
 } XAtom;
 
+// Submits frames for a window. With FG_PRESENT and a server supporting the Present extension, frames
+// are rendered into pixmaps and presented at the next vblank, with at most one frame in flight;
+// otherwise they are drawn straight to the window and flushed immediately.
+typedef struct {
+	xcb_connection_t *c;
+	xcb_window_t window;
+	cairo_surface_t *window_surface;
+	bool enabled;
+#ifdef FG_PRESENT
+	uint8_t opcode;
+	uint32_t eid;
+	struct {
+		xcb_pixmap_t pixmap;
+		cairo_surface_t *surface;
+		bool busy;
+	} buffers[2];
+	int back;
+	uint32_t serial;
+	bool pending;
+	bool dirty;
+	uint64_t msc;
+#endif
+} XPresenter;
+
 void c_offset_quads(cairo_t *cr, double offset, double end_alpha);
+void c_show_label(cairo_t *cr, const char *text, double size, int x, int y, int width, int height);
 void x_init(xcb_connection_t *c);
 xcb_screen_t* x_get_screen(xcb_connection_t *c, int i);
 xcb_visualtype_t* x_get_visual(xcb_screen_t *screen, int depth);
@@ -30,5 +62,9 @@ void x_set_net_wm_window_type(xcb_connection_t *c, xcb_window_t win, XAtom state
 void x_set_net_wm_struts(xcb_connection_t *c, xcb_screen_t *screen, xcb_window_t win, int left, int right, int top, int bottom);
 void x_raise_window(xcb_connection_t *c, xcb_window_t win);
 char* x_get_string_property(xcb_connection_t *c, xcb_window_t win, XAtom property);
+void x_present_init(XPresenter *p, xcb_connection_t *c, xcb_window_t window, xcb_visualtype_t *visual, int depth, int width, int height);
+cairo_surface_t* x_present_begin(XPresenter *p);
+void x_present_end(XPresenter *p);
+bool x_present_handle_event(XPresenter *p, xcb_generic_event_t *event);
 
 #endif